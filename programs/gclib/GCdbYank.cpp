@@ -298,8 +298,10 @@ GCdbYank::GCdbYank(const char* fidx, const char* recsep) {
  cdb=NULL;
 #ifdef ENABLE_COMPRESSION
  cdbz=NULL;
+ zreader=NULL;
 #endif 
  fdb=-1;
+ dbmap=NULL;
  fz=NULL;
  dbname=NULL;
  recdelim=Gstrdup(recsep);
@@ -343,6 +345,27 @@ GCdbYank::GCdbYank(const char* fidx, const char* recsep) {
       }
   }// database name not given
   is_compressed=(dbstat.idxflags & CDBMSK_OPT_COMPRESS);
+  if (is_compressed && (dbstat.idxflags & CDBMSK_OPT_BLOCKZ)) {
+    //block compressed: records are read through the block cache
+  #ifndef ENABLE_COMPRESSION
+    GError(err_COMPRESSED);
+  #else
+    is_compressed=false;
+    fdb=open(dbname, O_RDONLY|O_BINARY);
+    if (fdb==-1)
+      GError("Error: cannot open database file %s\n",dbname);
+    zreader=new GCdbBlockZReader(fdb);
+    off_t idxend=lseek(fd, -(off_t)(cdbInfoSIZE+dbstat.dbnamelen), SEEK_END);
+    if (!zreader->valid() || !zreader->readIndex(fd, idxend))
+      GError("Error: invalid block compressed database %s or index %s\n",
+              dbname, idxfile);
+    lseek(fd, 0, SEEK_SET);
+    struct stat fdbstat;
+    fstat(fdb, &fdbstat);
+    db_size=fdbstat.st_size;
+  #endif
+    }
+  else {
        if (is_compressed)
             //try to open the dbname as a compressed file
              fz=fopen(dbname, "rb");
@@ -375,12 +398,15 @@ GCdbYank::GCdbYank(const char* fidx, const char* recsep) {
           exit(1);
           }
         db_size=fdbstat.st_size;
+        dbmap=new GMappedFile(fdb);
+        if (!dbmap->mapped()) { delete dbmap; dbmap=NULL; }
         }
+    }
      //abort if the database size was read and it doesn't match the cdbfasta stored size
      if (dbstat.dbsize>0 && dbstat.dbsize!=db_size)
        GError("Error: invalid %d database size - (%lld vs %lld) please rerun cdbfasta for '%s'\n",
           fdb, dbstat.dbsize, db_size, dbname);
-   fastahandler=new GFastaCharHandler(recdelim);
+   pthread_mutex_init(&lock, NULL);
 } //* GCdbYank constructor *//
 
 GCdbYank::~GCdbYank() {
@@ -390,9 +416,15 @@ GCdbYank::~GCdbYank() {
      delete cdbz;
     #endif 
      }
-     else close(fdb);
+     else {
+       delete dbmap;
+      #ifdef ENABLE_COMPRESSION
+       delete zreader;
+      #endif
+       close(fdb);
+       }
  GFREE(info_dbname);
- delete fastahandler;
+ pthread_mutex_destroy(&lock);
  GFREE(recdelim);
  GFREE(dbname);
  GFREE(idxfile);
@@ -401,21 +433,18 @@ GCdbYank::~GCdbYank() {
 }
 
 
-int GCdbYank::getRecord(const char* key, FastaSeq& rec, charFunc* seqCallBack) {
-//assumes fdb is open, cdb was created on the index file
+//locates the record for a key in the fasta file
+//returns false if the key was not found
+bool GCdbYank::findRecord(const char* key, off_t& fpos, uint32& reclen) {
  int r=cdb->find(key);
- if (r==0) return 0;
+ if (r==0) return false;
  if (r==-1)
    GError("cdbyank: error searching for key %s in %s\n", key, idxfile);
- /* while (r>0) { */
  off_t pos = cdb->datapos(); //position of this key's record in the index file
  unsigned int len=cdb->datalen(); // length of this key's record
  char bytes[32]; // data buffer -- should just accomodate fastarec_pos, fastarec_length
  if (cdb->read(bytes,len,pos) == -1)
        GError("cdbyank: error at GCbd::read (%s)!\n", idxfile);
-
- off_t fpos; //this will be the fastadb offset
- uint32 reclen;  //this will be the fasta record offset
  if (len>8) { //64 bit file offset was used
   fpos=gcvt_offt(bytes);
   reclen=gcvt_uint(&bytes[sizeof(uint32)<<1]);
@@ -424,36 +453,63 @@ int GCdbYank::getRecord(const char* key, FastaSeq& rec, charFunc* seqCallBack) {
   fpos=gcvt_uint(bytes);
   reclen=gcvt_uint(&bytes[sizeof(uint32)]);
   }
-  //GMessage("reclen=%d\n", reclen);
+ return true;
+}
 
- /* if (showQuery)
-  fprintf(fout, "%c%s%c\t", delimQuery, key, delimQuery);*/
+int GCdbYank::getRecord(const char* key, FastaSeq& rec, charFunc* seqCallBack) {
+//assumes fdb is open, cdb was created on the index file
+ off_t fpos; //this will be the fastadb offset
+ uint32 reclen;  //this will be the fasta record length
+ GFastaCharHandler fastahandler(recdelim);
+ pthread_mutex_lock(&lock);
+ if (!findRecord(key, fpos, reclen)) {
+   pthread_mutex_unlock(&lock);
+   return 0;
+   }
   /*========= FETCHING RECORD CONTENT ======= */
    if (is_compressed) {
      //for now: ignore special retrievals, just print the whole record
      #ifdef ENABLE_COMPRESSION
-      return cdbz->decompress(rec, reclen, fpos, seqCallBack);
+      int r=cdbz->decompress(rec, reclen, fpos, seqCallBack);
+      pthread_mutex_unlock(&lock);
+      return r;
      #else
        GError(err_COMPRESSED);
      #endif
      }
-    else { // not compressed -- position into the file and build an ad hoc GFastaFile
-     lseek(fdb, fpos, SEEK_SET);
-     // read it char by char and return it as output
-     char c='\0';
-     int charsread=0;
-     fastahandler->init(&rec, seqCallBack);
-     while (reclen-- && read(fdb, &c, 1)==1) {
-       fastahandler->processChar(c);
-       charsread++;
-       }
-     fastahandler->done();
-     return charsread;
-     } // not compressed
-  /* if (many) r=cdb->findnext(key, strlen(key));
-        else r=0;
-   } */
- return 0;
+   const char* p=(dbmap!=NULL) ? dbmap->view(fpos, reclen) : NULL;
+   bool locked=true;
+   if (p!=NULL) { //the mapped file does not change, parse it unlocked
+     pthread_mutex_unlock(&lock);
+     locked=false;
+     }
+  #ifdef ENABLE_COMPRESSION
+   if (zreader!=NULL && (p=zreader->view(fpos, reclen))==NULL)
+     GError("GCdbYank: error decompressing the record for %s\n", key);
+  #endif
+   fastahandler.init(&rec, seqCallBack);
+   if (p!=NULL) { //parse the record in place
+     for (uint32 i=0;i<reclen;i++)
+       fastahandler.processChar(p[i]);
+     fastahandler.done();
+     if (locked) pthread_mutex_unlock(&lock); //block cache view
+     return reclen;
+     }
+   // not mapped -- position into the file and read it in chunks
+   lseek(fdb, fpos, SEEK_SET);
+   char buf[8192];
+   int charsread=0;
+   while (reclen>0) {
+     int r=read(fdb, buf, reclen<sizeof(buf) ? reclen : sizeof(buf));
+     if (r<=0) break;
+     for (int i=0;i<r;i++)
+       fastahandler.processChar(buf[i]);
+     charsread+=r;
+     reclen-=r;
+     }
+   pthread_mutex_unlock(&lock);
+   fastahandler.done();
+   return charsread;
 }
 
 off_t GCdbYank::getRecordPos(const char* key) {
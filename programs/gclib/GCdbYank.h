@@ -3,6 +3,7 @@
 
 #include "gcdb.h"
 #include <stdio.h>
+#include <pthread.h>
 #include "GFastaFile.h"
 // FastaSeq class and *charFunc() callback type
 
@@ -52,11 +53,14 @@ class GCdbYank {
   GCdbRead* cdb;
  #ifdef ENABLE_COMPRESSION
   GCdbZFasta* cdbz;
+  GCdbBlockZReader* zreader; //block compressed database (fdb)
  #endif
   int fdb;
+  GMappedFile* dbmap; //fdb mapped in memory (NULL if not possible)
   int fd;
   FILE* fz; // if compressed
-  GFastaCharHandler* fastahandler;
+  pthread_mutex_t lock; //guards the index lookups and the db file reads
+  bool findRecord(const char* key, off_t& fpos, uint32& reclen);
 #ifdef ENABLE_COMPRESSION
  protected: 
    GCdbZFasta* openCdbz(char* p);
@@ -64,6 +68,8 @@ class GCdbYank {
  public:
   GCdbYank(const char* fidx, const char* recsep=DEF_CDBREC_DELIM);
   ~GCdbYank();
+  //getRecord() can be called by multiple threads at once (records from
+  //a mapped fasta file are parsed outside the lock)
   int getRecord(const char* key, FastaSeq& rec, charFunc* seqCallBack=NULL);
   off_t getRecordPos(const char* key);
   char* getDbName() { return dbname; }
@@ -0,0 +1,346 @@
+#include "GHitBin.h"
+
+#define ERR_BIN_TRUNCATED "GHitBinReader error: truncated hit record!\n"
+
+//returns the end of the tab-delimited field starting at p
+static char* fieldEnd(char* p) {
+ while (*p!='\t' && *p!='\0') p++;
+ return p;
+}
+
+static int fieldInt(char* s, char* line, int col) {
+ char* endp;
+ long v=strtol(s, &endp, 10);
+ if (endp==s || *endp!='\0')
+   GError("Invalid hit line for '%s' (column %d: '%s')\n", line, col, s);
+ return (int)v;
+}
+
+bool GHitBinRec::parseText(char* line) {
+ if (line[0]=='\0' || line[0]=='#' || line[0]=='\n') return false;
+ char* fields[15];
+ int nf=0;
+ char* p=line;
+ while (nf<15) {
+   fields[nf++]=p;
+   p=fieldEnd(p);
+   if (*p=='\0') break;
+   *p='\0';
+   p++;
+   }
+ //a trailing newline or CR is not part of the last field
+ p=fields[nf-1]+strlen(fields[nf-1]);
+ while (p>fields[nf-1] && (p[-1]=='\n' || p[-1]=='\r')) *(--p)='\0';
+ if (nf!=12 && nf!=14)
+   GError("Invalid hit line for '%s' (%d columns found, 12 or 14 expected)\n",
+          line, nf);
+ qname=fields[0];
+ qlen=fieldInt(fields[1], line, 2);
+ q5=fieldInt(fields[2], line, 3);
+ q3=fieldInt(fields[3], line, 4);
+ hname=fields[4];
+ hlen=fieldInt(fields[5], line, 6);
+ h5=fieldInt(fields[6], line, 7);
+ h3=fieldInt(fields[7], line, 8);
+ char* endp;
+ double pid=strtod(fields[8], &endp);
+ if (endp==fields[8] || *endp!='\0')
+   GError("Invalid hit line for '%s' (column 9: '%s')\n", line, fields[8]);
+ pid100=iround(pid*100.0);
+ score=fieldInt(fields[9], line, 10);
+ score2=fields[10];
+ strand=fields[11][0];
+ hasGaps=(nf==14);
+ qgaps=hasGaps ? fields[12] : NULL;
+ hgaps=hasGaps ? fields[13] : NULL;
+ return true;
+}
+
+int GHitBinRec::formatText(char*& buf, int& bufcap) {
+ int len=strlen(qname)+strlen(hname)+strlen(score2)+12*14;
+ if (hasGaps) len+=strlen(qgaps)+strlen(hgaps);
+ if (len>=bufcap) {
+   bufcap=len+1;
+   GREALLOC(buf, bufcap);
+   }
+ //the percent identity is printed the way mgblast does (%.2f)
+ len=sprintf(buf, "%s\t%d\t%d\t%d\t%s\t%d\t%d\t%d\t%s%d.%02d\t%d\t%s\t%c",
+        qname, qlen, q5, q3, hname, hlen, h5, h3, (pid100<0) ? "-" : "",
+        abs(pid100)/100, abs(pid100)%100, score, score2, strand);
+ if (hasGaps)
+   len+=sprintf(buf+len, "\t%s\t%s", qgaps, hgaps);
+ return len;
+}
+
+void GHitBinRec::writeText(FILE* f) {
+ fprintf(f, "%s\t%d\t%d\t%d\t%s\t%d\t%d\t%d\t%s%d.%02d\t%d\t%s\t%c",
+        qname, qlen, q5, q3, hname, hlen, h5, h3, (pid100<0) ? "-" : "",
+        abs(pid100)/100, abs(pid100)%100, score, score2, strand);
+ if (hasGaps)
+   fprintf(f, "\t%s\t%s", qgaps, hgaps);
+ fputc('\n', f);
+}
+
+//========== GHitBinReader
+
+bool GHitBinReader::isBinary(FILE* f) {
+ int c=getc(f);
+ if (c==EOF) return false;
+ ungetc(c, f);
+ return (c==(unsigned char)GHITBIN_MAGIC[0]);
+}
+
+GHitBinReader::GHitBinReader(FILE* inf) {
+ f=inf;
+ names=NULL;
+ numnames=0;
+ namecap=0;
+ GMALLOC(fbuf, GHITBIN_IOBUF);
+ fpos=0;
+ flen=0;
+ sbuf=NULL;
+ scap=0;
+ memset(&rec, 0, sizeof(GHitBinRec));
+ if (getByte()!=(unsigned char)GHITBIN_MAGIC[0])
+   GError("GHitBinReader error: input is not a binary hit file!\n");
+ readHeader();
+}
+
+//checks the rest of a stream header (after its first byte)
+//and starts a new name dictionary
+void GHitBinReader::readHeader() {
+ for (int i=1;i<4;i++)
+   if (getByte()!=(unsigned char)GHITBIN_MAGIC[i])
+     GError("GHitBinReader error: input is not a binary hit file!\n");
+ int v=getByte();
+ if (v<1 || v>GHITBIN_VERSION)
+   GError("GHitBinReader error: unsupported binary hit format version (%d)!\n", v);
+ for (int i=0;i<numnames;i++) GFREE(names[i]);
+ numnames=0;
+}
+
+GHitBinReader::~GHitBinReader() {
+ for (int i=0;i<numnames;i++) GFREE(names[i]);
+ GFREE(names);
+ GFREE(fbuf);
+ GFREE(sbuf);
+}
+
+bool GHitBinReader::fillBuf() {
+ flen=(int)fread(fbuf, 1, GHITBIN_IOBUF, f);
+ fpos=0;
+ if (flen==0 && ferror(f))
+   GError("GHitBinReader error: failed reading input!\n");
+ return (flen>0);
+}
+
+unsigned int GHitBinReader::getVarint() {
+ unsigned int v=0;
+ int shift=0;
+ int c;
+ do {
+   if ((c=getByte())<0 || shift>28) GError(ERR_BIN_TRUNCATED);
+   v|=(unsigned int)(c & 0x7f) << shift;
+   shift+=7;
+   } while (c & 0x80);
+ return v;
+}
+
+int GHitBinReader::getInt() {
+ unsigned int v=getVarint();
+ return (int)(v>>1) ^ -(int)(v & 1);
+}
+
+void GHitBinReader::getBytes(char* dest, int len) {
+ while (len>0) {
+   if (fpos==flen && !fillBuf()) GError(ERR_BIN_TRUNCATED);
+   int n=flen-fpos;
+   if (n>len) n=len;
+   memcpy(dest, fbuf+fpos, n);
+   fpos+=n;
+   dest+=n;
+   len-=n;
+   }
+}
+
+GHitBinRec* GHitBinReader::next() {
+ int tag;
+ while ((tag=getByte())=='N' || tag==(unsigned char)GHITBIN_MAGIC[0]) {
+   if (tag!='N') {
+     readHeader();
+     continue;
+     }
+   int len=getVarint();
+   if (numnames==namecap) {
+     namecap=(namecap==0) ? 1024 : namecap*2;
+     GREALLOC(names, namecap*sizeof(char*));
+     }
+   GMALLOC(names[numnames], len+1);
+   getBytes(names[numnames], len);
+   names[numnames][len]='\0';
+   numnames++;
+   }
+ if (tag<0) return NULL;
+ if (tag!='H' && tag!='G')
+   GError("GHitBinReader error: invalid record type (%d) in input!\n", tag);
+ int qid=getVarint();
+ rec.qlen=getInt();
+ rec.q5=getInt();
+ rec.q3=getInt();
+ int hid=getVarint();
+ rec.hlen=getInt();
+ rec.h5=getInt();
+ rec.h3=getInt();
+ rec.pid100=getInt();
+ rec.score=getInt();
+ rec.strand=(char)getByte();
+ if (qid>=numnames || hid>=numnames)
+   GError("GHitBinReader error: undefined sequence name ID (%d/%d)!\n", qid, hid);
+ rec.qname=names[qid];
+ rec.hname=names[hid];
+ rec.hasGaps=(tag=='G');
+ //the string fields are stored back to back in sbuf
+ int nstr=rec.hasGaps ? 3 : 1;
+ int ofs[3];
+ int slen=0;
+ for (int i=0;i<nstr;i++) {
+   int len=getVarint();
+   if (slen+len+1>scap) {
+     scap=slen+len+1+256;
+     GREALLOC(sbuf, scap);
+     }
+   getBytes(sbuf+slen, len);
+   ofs[i]=slen;
+   slen+=len;
+   sbuf[slen++]='\0';
+   }
+ rec.score2=sbuf+ofs[0];
+ rec.qgaps=rec.hasGaps ? sbuf+ofs[1] : NULL;
+ rec.hgaps=rec.hasGaps ? sbuf+ofs[2] : NULL;
+ return &rec;
+}
+
+//========== GHitBinWriter
+
+GHitBinWriter::GHitBinWriter(FILE* outf):ids() {
+ f=NULL;
+ numnames=0;
+ ocap=1024;
+ opos=0;
+ GMALLOC(obuf, ocap);
+ tbuf=NULL;
+ tcap=0;
+ newStream=true;
+ if (outf!=NULL) reset(outf);
+}
+
+GHitBinWriter::~GHitBinWriter() {
+ GFREE(obuf);
+ GFREE(tbuf);
+}
+
+void GHitBinWriter::reset(FILE* outf) {
+ f=outf;
+ restart();
+}
+
+void GHitBinWriter::restart() {
+ ids.Clear();
+ numnames=0;
+ newStream=true;
+}
+
+void GHitBinWriter::grow(int len) {
+ while (ocap<opos+len) ocap*=2;
+ GREALLOC(obuf, ocap);
+}
+
+void GHitBinWriter::putVarint(unsigned int v) {
+ while (v>=0x80) {
+   putByte((unsigned char)(v | 0x80));
+   v>>=7;
+   }
+ putByte((unsigned char)v);
+}
+
+void GHitBinWriter::putBytes(const char* s, int len) {
+ if (opos+len>ocap) grow(len);
+ memcpy(obuf+opos, s, len);
+ opos+=len;
+}
+
+void GHitBinWriter::putString(const char* s) {
+ int len=strlen(s);
+ putVarint(len);
+ putBytes(s, len);
+}
+
+//new names are defined in the output just before their first use
+int GHitBinWriter::nameID(const char* name) {
+ int* id=ids.Find(name);
+ if (id!=NULL) return *id;
+ ids.Add(name, new int(numnames));
+ putByte('N');
+ putString(name);
+ return numnames++;
+}
+
+void GHitBinWriter::write(GHitBinRec& r) {
+ if (f==NULL) GError("GHitBinWriter error: no output stream!\n");
+ int len;
+ encode(r, len);
+ if ((int)fwrite(obuf, 1, len, f)!=len)
+   GError("GHitBinWriter error: failed writing output!\n");
+}
+
+const char* GHitBinWriter::encode(GHitBinRec& r, int& len) {
+ opos=0;
+ if (newStream) {
+   putBytes(GHITBIN_MAGIC, 4);
+   putByte(GHITBIN_VERSION);
+   newStream=false;
+   }
+ int qid=nameID(r.qname);
+ int hid=nameID(r.hname);
+ putByte(r.hasGaps ? 'G' : 'H');
+ putVarint(qid);
+ putInt(r.qlen);
+ putInt(r.q5);
+ putInt(r.q3);
+ putVarint(hid);
+ putInt(r.hlen);
+ putInt(r.h5);
+ putInt(r.h3);
+ putInt(r.pid100);
+ putInt(r.score);
+ putByte(r.strand);
+ putString(r.score2);
+ if (r.hasGaps) {
+   putString(r.qgaps);
+   putString(r.hgaps);
+   }
+ len=opos;
+ return (const char*)obuf;
+}
+
+const char* GHitBinWriter::encodeText(const char* line, int& len) {
+ int llen=strlen(line);
+ if (llen>=tcap) {
+   tcap=llen+1;
+   GREALLOC(tbuf, tcap);
+   }
+ memcpy(tbuf, line, llen+1);
+ GHitBinRec r;
+ if (!r.parseText(tbuf)) return NULL;
+ return encode(r, len);
+}
+
+bool GHitBinWriter::writeText(const char* line) {
+ if (f==NULL) GError("GHitBinWriter error: no output stream!\n");
+ int len;
+ const char* data=encodeText(line, len);
+ if (data==NULL) return false;
+ if ((int)fwrite(data, 1, len, f)!=len)
+   GError("GHitBinWriter error: failed writing output!\n");
+ return true;
+}
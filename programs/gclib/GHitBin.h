@@ -0,0 +1,118 @@
+#ifndef GHITBIN_H
+#define GHITBIN_H
+#include "GBase.h"
+#include "GHash.hh"
+
+/* Compact binary form of the mgblast tabulated hits (mgblast -D6/-D7).
+ A stream starts with the magic bytes "\x89GHB" followed by one format
+ version byte, then a sequence of records, each starting with a tag byte:
+   'N' <len> <name>  : defines the next sequence name ID (0, 1, 2 ...)
+   'H' <qid> <qlen> <q5> <q3> <hid> <hlen> <h5> <h3> <pid*100> <score>
+       <strand char> <len> <score2 text>
+   'G' same as 'H', followed by <len> <q_gapinfo> <len> <hit_gapinfo>
+ All integers are zigzag-encoded base-128 varints; the coordinates are
+ kept exactly as mgblast printed them (not normalized) and the e-value
+ is kept as text, so mgblast output converts back to the same lines.
+ A stream header may also appear between records, starting a new name
+ dictionary, so concatenated streams are still a valid stream.
+*/
+
+#define GHITBIN_MAGIC "\x89GHB"
+#define GHITBIN_VERSION 1
+#define GHITBIN_IOBUF 65536
+
+//one hit, with the fields in mgblast's column order
+struct GHitBinRec {
+  char* qname;
+  int qlen, q5, q3;
+  char* hname;
+  int hlen, h5, h3;
+  int pid100; //percent identity * 100
+  int score;
+  char* score2; //e-value column, as text
+  char strand; //0 if the column was missing
+  bool hasGaps; //the 2 gap info columns are present
+  char* qgaps;
+  char* hgaps;
+  //tokenizes a text hit line in place; returns false for
+  //empty or comment lines
+  bool parseText(char* line);
+  //formats the hit as a text line (with no newline) into buf
+  int formatText(char*& buf, int& bufcap);
+  void writeText(FILE* f);
+};
+
+class GHitBinReader {
+ protected:
+  FILE* f;
+  char** names; //the name dictionary, indexed by ID
+  int numnames;
+  int namecap;
+  char* fbuf; //input buffer
+  int fpos;
+  int flen;
+  char* sbuf; //storage for the string fields of the current hit
+  int scap;
+  GHitBinRec rec;
+  int getByte() {
+     if (fpos==flen && !fillBuf()) return -1;
+     return (unsigned char)fbuf[fpos++];
+     }
+  bool fillBuf();
+  void readHeader();
+  unsigned int getVarint();
+  int getInt();
+  void getBytes(char* dest, int len);
+ public:
+  //true if f is positioned at the start of a binary hit stream
+  //(only the first byte is checked; it is pushed back)
+  static bool isBinary(FILE* f);
+  GHitBinReader(FILE* inf); //reads and checks the stream header
+  ~GHitBinReader();
+  //returns the next hit or NULL at the end of the stream;
+  //the record is valid until the following call
+  GHitBinRec* next();
+  GHitBinRec* current() { return &rec; }
+  int namesCount() { return numnames; }
+};
+
+class GHitBinWriter {
+ protected:
+  FILE* f;
+  GHash<int> ids; //name dictionary
+  int numnames;
+  unsigned char* obuf; //the record being encoded
+  int opos;
+  int ocap;
+  char* tbuf; //copy of a text line being converted
+  int tcap;
+  void putByte(unsigned char c) {
+     if (opos==ocap) grow(1);
+     obuf[opos++]=c;
+     }
+  void grow(int len);
+  void putVarint(unsigned int v);
+  void putInt(int v) { putVarint(((unsigned int)v<<1) ^ (unsigned int)(v>>31)); }
+  void putBytes(const char* s, int len);
+  void putString(const char* s);
+  int nameID(const char* name);
+  bool newStream; //the stream header is to be written
+ public:
+  GHitBinWriter(FILE* outf=NULL);
+  ~GHitBinWriter();
+  //starts a new stream (header, empty dictionary) into outf
+  void reset(FILE* outf);
+  //starts a new stream without an output file, for encode()
+  void restart();
+  void write(GHitBinRec& r);
+  //parses and writes a text hit line; returns false for
+  //empty or comment lines, which are skipped
+  bool writeText(const char* line);
+  //encodes a hit in memory, preceded by the stream header and name
+  //records as needed; the data is valid until the next call
+  const char* encode(GHitBinRec& r, int& len);
+  //same for a text hit line; returns NULL for empty or comment lines
+  const char* encodeText(const char* line, int& len);
+};
+
+#endif
@@ -0,0 +1,418 @@
+#include "GHitParser.h"
+#include <ctype.h>
+
+GHitParser::GHitParser(FILE* inf, GHitFilterProc* flt, void* fltdata,
+                       int threads, bool gapinfo, int bsize) {
+ f=inf;
+ fltProc=flt;
+ fltData=fltdata;
+ gapInfo=gapinfo;
+ numThreads=(threads<1) ? 1 : threads;
+ blockSize=(bsize<1024) ? 1024 : bsize;
+ //enough blocks to keep all workers busy while the output waits
+ numBlocks=(numThreads==1) ? 1 : numThreads*2+2;
+ GCALLOC(blocks, numBlocks*sizeof(HitBlock));
+ carry=NULL;
+ carrylen=0;
+ carrycap=0;
+ fdone=false;
+ eof=false;
+ aborted=false;
+ lastBlock=0;
+ nextParse=0;
+ outBlock=0;
+ outHit=0;
+ outReady=false;
+ started=false;
+ workers=NULL;
+ binReader=NULL;
+ binPending=false;
+ if (GHitBinReader::isBinary(f)) binReader=new GHitBinReader(f);
+ pthread_mutex_init(&lock, NULL);
+ pthread_cond_init(&cond, NULL);
+}
+
+GHitParser::~GHitParser() {
+ if (started) {
+   pthread_mutex_lock(&lock);
+   aborted=true;
+   pthread_cond_broadcast(&cond);
+   pthread_mutex_unlock(&lock);
+   pthread_join(reader, NULL);
+   for (int i=0;i<numThreads;i++)
+     pthread_join(workers[i], NULL);
+   GFREE(workers);
+   }
+ for (int i=0;i<numBlocks;i++) {
+   GFREE(blocks[i].buf);
+   GFREE(blocks[i].hits);
+   GFREE(blocks[i].recs);
+   }
+ GFREE(blocks);
+ GFREE(carry);
+ delete binReader;
+ pthread_cond_destroy(&cond);
+ pthread_mutex_destroy(&lock);
+}
+
+//reads the next newline-aligned chunk of input into b
+//returns false if there is nothing left to read
+bool GHitParser::fillBlock(HitBlock& b) {
+ if (binReader!=NULL) return fillBinBlock(b);
+ b.buflen=0;
+ b.hitcount=0;
+ if (fdone) return false;
+ if (b.bufcap<carrylen+blockSize+1) {
+   b.bufcap=carrylen+blockSize+1;
+   GREALLOC(b.buf, b.bufcap);
+   }
+ //start with the incomplete line left from the previous block
+ if (carrylen>0) {
+   memcpy(b.buf, carry, carrylen);
+   b.buflen=carrylen;
+   carrylen=0;
+   }
+ int lastnl=-1;
+ while (lastnl<0) {
+   int toread=b.bufcap-1-b.buflen;
+   int r=(int)fread(b.buf+b.buflen, 1, toread, f);
+   int from=b.buflen;
+   b.buflen+=r;
+   if (r<toread) {
+     if (ferror(f)) GError("GHitParser error: failed reading input!\n");
+     fdone=true;
+     break;
+     }
+   for (int i=b.buflen-1;i>=from;i--)
+     if (b.buf[i]=='\n') { lastnl=i; break; }
+   if (lastnl<0) { //very long line, make room for more
+     b.bufcap*=2;
+     GREALLOC(b.buf, b.bufcap);
+     }
+   }
+ if (lastnl>=0 && lastnl<b.buflen-1) {
+   //keep the partial last line for the next block
+   carrylen=b.buflen-lastnl-1;
+   if (carrylen>carrycap) {
+     carrycap=carrylen;
+     GREALLOC(carry, carrycap);
+     }
+   memcpy(carry, b.buf+lastnl+1, carrylen);
+   b.buflen=lastnl+1;
+   }
+ b.buf[b.buflen]='\0';
+ return (b.buflen>0);
+}
+
+//decodes the next binary hits into b; their strings are copied into the
+//block buffer, as the reader's own storage only lasts until its next record
+bool GHitParser::fillBinBlock(HitBlock& b) {
+ b.buflen=0;
+ b.hitcount=0;
+ b.reccount=0;
+ if (fdone) return false;
+ if (b.bufcap<blockSize) {
+   b.bufcap=blockSize;
+   GREALLOC(b.buf, b.bufcap);
+   }
+ while (true) {
+   GHitBinRec* r=binPending ? binReader->current() : binReader->next();
+   binPending=false;
+   if (r==NULL) {
+     fdone=true;
+     break;
+     }
+   char* str[5]={r->qname, r->hname, r->score2, r->qgaps, r->hgaps};
+   int len[5];
+   int need=0;
+   for (int i=0;i<5;i++) {
+     len[i]=(str[i]==NULL) ? -1 : (int)strlen(str[i]);
+     need+=len[i]+1;
+     }
+   if (b.buflen+need>b.bufcap) {
+     //the strings already copied must not move: this hit starts the
+     //next block, unless it is too big for any block
+     if (b.reccount>0) {
+       binPending=true;
+       break;
+       }
+     b.bufcap=need;
+     GREALLOC(b.buf, b.bufcap);
+     }
+   if (b.reccount==b.reccap) {
+     b.reccap=(b.reccap==0) ? 4096 : b.reccap*2;
+     GREALLOC(b.recs, b.reccap*sizeof(GHitBinRec));
+     }
+   GHitBinRec& c=b.recs[b.reccount++];
+   c=*r;
+   char** dest[5]={&c.qname, &c.hname, &c.score2, &c.qgaps, &c.hgaps};
+   for (int i=0;i<5;i++) {
+     if (len[i]<0) continue;
+     *dest[i]=b.buf+b.buflen;
+     memcpy(*dest[i], str[i], len[i]+1);
+     b.buflen+=len[i]+1;
+     }
+   }
+ return (b.reccount>0);
+}
+
+//parses a numeric field and moves p to the start of the next field
+static double hitNumber(char*& p, char* line) {
+ while (isspace(*p)) p++;
+ char* endp;
+ double d=strtod(p, &endp);
+ if (endp==p) GError(ERR_INVALID_HIT, line);
+ p=endp;
+ while (*p!='\t' && *p!='\0') p++;
+ if (*p=='\t') p++;
+ return d;
+}
+
+//returns false for empty or comment lines
+bool GHitParser::parseLine(char* line, int len, GHitRec& h) {
+ if (len<=1 || line[0]=='#') return false;
+ h.line=line;
+ h.linelen=len;
+ h.brec=NULL;
+ char* p=line;
+ while (*p!='\t' && *p!='\0') p++;
+ if (*p=='\0' || p==line) GError(ERR_INVALID_HIT, line);
+ *p='\0';
+ h.qname=line;
+ p++;
+ h.qlen=iround(hitNumber(p, line));
+ h.q5=iround(hitNumber(p, line));
+ h.q3=iround(hitNumber(p, line));
+ if (h.q5==h.q3) GError(ERR_INVALID_HIT, line);
+ h.minus=false;
+ if (h.q5>h.q3) {
+   swap(h.q5, h.q3);
+   h.minus=true;
+   }
+ while (isspace(*p)) p++;
+ if (*p=='\0') GError(ERR_INVALID_HIT, line);
+ h.hname=p;
+ while (!isspace(*p) && *p!='\0') p++;
+ if (*p!='\0') { *p='\0'; p++; }
+ h.hlen=iround(hitNumber(p, line));
+ h.h5=iround(hitNumber(p, line));
+ h.h3=iround(hitNumber(p, line));
+ if (h.h5==h.h3) GError(ERR_INVALID_HIT, line);
+ if (h.h5>h.h3) {
+   swap(h.h5, h.h3);
+   h.minus=!h.minus;
+   }
+ h.pid=hitNumber(p, line);
+ h.score=hitNumber(p, line);
+ h.score2=(*p=='\0') ? 0 : hitNumber(p, line);
+ while (isspace(*p)) p++;
+ h.strand=*p;
+ h.qgaps=NULL;
+ h.hgaps=NULL;
+ if (gapInfo) {
+   if (h.strand!='+' && h.strand!='-')
+     GError("Error parsing hit orientation at (p='%s'): %s\n", p, line);
+   p++;
+   if (*p=='\t') {//gap info present
+     p++;
+     h.qgaps=p;
+     while (*p!='\t' && *p!='\0') p++;
+     if (*p=='\t') {
+       if (h.qgaps==p) h.qgaps=NULL;
+       *p='\0';
+       p++;
+       }
+     else if (h.qgaps==p) h.qgaps=NULL;
+     h.hgaps=p;
+     while (*p!='\t' && *p!='\0') p++;
+     if (h.hgaps==p) h.hgaps=NULL;
+                else *p='\0';
+     }
+   }
+ return true;
+}
+
+void GHitParser::parseBlock(HitBlock& b) {
+ b.hitcount=0;
+ if (binReader!=NULL) {
+   if (b.hitcap<b.reccount) {
+     b.hitcap=b.reccount;
+     GREALLOC(b.hits, b.hitcap*sizeof(GHitRec));
+     }
+   for (int i=0;i<b.reccount;i++) {
+     GHitRec& h=b.hits[b.hitcount];
+     binToHit(b.recs[i], h);
+     if (fltProc==NULL || fltProc(h, fltData))
+       b.hitcount++;
+     }
+   return;
+   }
+ char* p=b.buf;
+ char* bend=b.buf+b.buflen;
+ while (p<bend) {
+   char* eol=(char*)memchr(p, '\n', bend-p);
+   if (eol==NULL) eol=bend;
+   *eol='\0';
+   if (b.hitcount==b.hitcap) {
+     b.hitcap=(b.hitcap==0) ? 4096 : b.hitcap*2;
+     GREALLOC(b.hits, b.hitcap*sizeof(GHitRec));
+     }
+   GHitRec& h=b.hits[b.hitcount];
+   if (parseLine(p, eol-p, h) && (fltProc==NULL || fltProc(h, fltData)))
+     b.hitcount++;
+   p=eol+1;
+   }
+}
+
+void* GHitParser::readerThread(void* p) {
+ GHitParser* hp=(GHitParser*)p;
+ long bno=0;
+ while (true) {
+   HitBlock& b=hp->blocks[bno % hp->numBlocks];
+   pthread_mutex_lock(&hp->lock);
+   while (b.state!=hbFree && !hp->aborted)
+     pthread_cond_wait(&hp->cond, &hp->lock);
+   bool stop=hp->aborted;
+   pthread_mutex_unlock(&hp->lock);
+   if (stop) break;
+   bool more=hp->fillBlock(b);
+   pthread_mutex_lock(&hp->lock);
+   if (more) {
+     b.state=hbFilled;
+     bno++;
+     }
+   else {
+     hp->eof=true;
+     hp->lastBlock=bno;
+     }
+   pthread_cond_broadcast(&hp->cond);
+   pthread_mutex_unlock(&hp->lock);
+   if (!more) break;
+   }
+ return NULL;
+}
+
+void* GHitParser::workerThread(void* p) {
+ GHitParser* hp=(GHitParser*)p;
+ while (true) {
+   pthread_mutex_lock(&hp->lock);
+   while (!hp->aborted && !(hp->eof && hp->nextParse>=hp->lastBlock) &&
+          hp->blocks[hp->nextParse % hp->numBlocks].state!=hbFilled)
+     pthread_cond_wait(&hp->cond, &hp->lock);
+   if (hp->aborted || (hp->eof && hp->nextParse>=hp->lastBlock)) {
+     pthread_mutex_unlock(&hp->lock);
+     break;
+     }
+   HitBlock& b=hp->blocks[hp->nextParse % hp->numBlocks];
+   b.state=hbParsing;
+   hp->nextParse++;
+   pthread_mutex_unlock(&hp->lock);
+   hp->parseBlock(b);
+   pthread_mutex_lock(&hp->lock);
+   b.state=hbReady;
+   pthread_cond_broadcast(&hp->cond);
+   pthread_mutex_unlock(&hp->lock);
+   }
+ return NULL;
+}
+
+void GHitParser::startThreads() {
+ started=true;
+ GMALLOC(workers, numThreads*sizeof(pthread_t));
+ if (pthread_create(&reader, NULL, readerThread, this)!=0)
+   GError("GHitParser error: cannot create the reader thread!\n");
+ for (int i=0;i<numThreads;i++)
+   if (pthread_create(&workers[i], NULL, workerThread, this)!=0)
+     GError("GHitParser error: cannot create worker thread %d!\n", i+1);
+}
+
+//fills h from a decoded binary record, normalized as parseLine() does
+void GHitParser::binToHit(GHitBinRec& r, GHitRec& h) {
+ h.line=NULL;
+ h.linelen=0;
+ h.brec=&r;
+ h.qname=r.qname;
+ h.qlen=r.qlen;
+ h.q5=r.q5;
+ h.q3=r.q3;
+ h.hname=r.hname;
+ h.hlen=r.hlen;
+ h.h5=r.h5;
+ h.h3=r.h3;
+ if (h.q5==h.q3 || h.h5==h.h3)
+   GError("Invalid hit encountered (%s vs %s)\n", h.qname, h.hname);
+ h.minus=false;
+ if (h.q5>h.q3) {
+   swap(h.q5, h.q3);
+   h.minus=true;
+   }
+ if (h.h5>h.h3) {
+   swap(h.h5, h.h3);
+   h.minus=!h.minus;
+   }
+ h.pid=r.pid100/100.0;
+ h.score=r.score;
+ h.score2=strtod(r.score2, NULL);
+ h.strand=r.strand;
+ h.qgaps=NULL;
+ h.hgaps=NULL;
+ if (gapInfo) {
+   if (h.strand!='+' && h.strand!='-')
+     GError("Error parsing hit orientation (%s vs %s)\n", h.qname, h.hname);
+   if (r.hasGaps) {
+     if (r.qgaps[0]!='\0') h.qgaps=r.qgaps;
+     if (r.hgaps[0]!='\0') h.hgaps=r.hgaps;
+     }
+   }
+}
+
+GHitRec* GHitParser::next() {
+ if (numThreads==1) {
+   HitBlock& b=blocks[0];
+   while (outHit>=b.hitcount) {
+     if (!fillBlock(b)) return NULL;
+     parseBlock(b);
+     outHit=0;
+     }
+   return &b.hits[outHit++];
+   }
+ if (!started) startThreads();
+ while (true) {
+   if (outReady) {
+     HitBlock& b=blocks[outBlock % numBlocks];
+     if (outHit<b.hitcount) return &b.hits[outHit++];
+     //done with this block, give it back to the reader
+     pthread_mutex_lock(&lock);
+     b.state=hbFree;
+     outBlock++;
+     outReady=false;
+     pthread_cond_broadcast(&cond);
+     pthread_mutex_unlock(&lock);
+     }
+   HitBlock& b=blocks[outBlock % numBlocks];
+   pthread_mutex_lock(&lock);
+   while (b.state!=hbReady && !(eof && outBlock>=lastBlock))
+     pthread_cond_wait(&cond, &lock);
+   bool done=(b.state!=hbReady);
+   pthread_mutex_unlock(&lock);
+   if (done) return NULL;
+   outReady=true;
+   outHit=0;
+   }
+}
+
+void GHitParser::writeLine(FILE* fout, GHitRec& h) {
+ if (h.brec!=NULL) {
+   h.brec->writeText(fout);
+   return;
+   }
+ //the separators replaced by NUL while parsing were tabs
+ char* p=h.line;
+ char* lend=h.line+h.linelen;
+ while (p<lend) {
+   fputs(p, fout);
+   p+=strlen(p);
+   if (p<lend) { fputc('\t', fout); p++; }
+   }
+ fputc('\n', fout);
+}
@@ -0,0 +1,109 @@
+#ifndef GHITPARSER_H
+#define GHITPARSER_H
+#include "GBase.h"
+#include "GHitBin.h"
+#include <pthread.h>
+
+/* Chunked parser for the tabulated hit lines written by mgblast:
+ q_name q_len q_n5 q_n3 hit_name hit_len hit_n5 hit_n3 pid score score2 strand
+  [q_gapinfo hit_gapinfo]
+ The input is read in large newline-aligned blocks; with more than one
+ thread, a reader thread fills the blocks while worker threads tokenize
+ them and apply the caller's filter. Hits are always returned by next()
+ in input order, whatever the number of threads.
+ Binary hit files (see GHitBin.h) are detected automatically; their
+ records are decoded in input order on the reader side (the name
+ dictionary makes the stream sequential) into the same blocks, and the
+ worker threads check and filter them like the text hits.
+*/
+
+#define GHIT_BLOCK_SIZE 4194304
+#define ERR_INVALID_HIT "Invalid input line encountered:\n%s\n"
+
+//one parsed hit; all the strings point into the block buffer
+struct GHitRec {
+  char* line; //start of the original line (names are now NUL-terminated),
+              //NULL for binary input
+  int linelen;
+  char* qname;
+  int qlen, q5, q3; // q5<q3 always
+  char* hname;
+  int hlen, h5, h3; // h5<h3 always
+  bool minus; //the coordinates were reversed on exactly one sequence
+  double pid;
+  double score;
+  double score2;
+  char strand; //strand column value ('+' or '-'), 0 if missing
+  char* qgaps; //gap info (only parsed if requested, NULL otherwise)
+  char* hgaps;
+  GHitBinRec* brec; //the decoded record for binary input, NULL for text
+};
+
+/* Filter callback: return false to discard a hit. With multiple threads
+   it is called concurrently from the worker threads, so it should only
+   read shared data (exclusion lists, thresholds etc.).
+*/
+typedef bool GHitFilterProc(GHitRec& hit, void* data);
+
+class GHitParser {
+ protected:
+  enum { hbFree=0, hbFilled, hbParsing, hbReady };
+  struct HitBlock {
+    char* buf;
+    int bufcap;
+    int buflen;
+    GHitRec* hits;
+    int hitcap;
+    int hitcount;
+    GHitBinRec* recs; //binary input: the decoded records, with their
+    int reccap;       //strings copied into buf
+    int reccount;
+    int state;
+    };
+  FILE* f;
+  GHitFilterProc* fltProc;
+  void* fltData;
+  bool gapInfo;
+  int numThreads;
+  int blockSize;
+  HitBlock* blocks; //ring of blocks, block #s is blocks[s % numBlocks]
+  int numBlocks;
+  char* carry; //incomplete last line of the previous block
+  int carrylen;
+  int carrycap;
+  bool fdone; //end of input file reached (reader side only)
+  bool eof; //the reader is done
+  bool aborted; //the parser is being destroyed
+  long lastBlock; //total number of blocks, once eof
+  long nextParse; //next block # to be taken by a worker
+  long outBlock; //block # being returned by next()
+  int outHit;
+  bool outReady; //block #outBlock is parsed and being returned
+  bool started;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  pthread_t reader;
+  pthread_t* workers;
+  GHitBinReader* binReader; //for binary input only
+  bool binPending; //the reader's current record goes into the next block
+  bool fillBlock(HitBlock& b);
+  bool fillBinBlock(HitBlock& b);
+  void parseBlock(HitBlock& b);
+  bool parseLine(char* line, int len, GHitRec& h);
+  static void* readerThread(void* p);
+  static void* workerThread(void* p);
+  void startThreads();
+  void binToHit(GHitBinRec& r, GHitRec& h);
+ public:
+  GHitParser(FILE* inf, GHitFilterProc* flt=NULL, void* fltdata=NULL,
+             int threads=1, bool gapinfo=false, int bsize=GHIT_BLOCK_SIZE);
+  ~GHitParser();
+  //returns the next hit that passed the filter, or NULL at the end of input;
+  //the record is valid until the following call
+  GHitRec* next();
+  //writes the original line of the hit last returned by next() to fout
+  void writeLine(FILE* fout, GHitRec& h);
+  bool isBinary() { return (binReader!=NULL); }
+};
+
+#endif
@@ -1086,7 +1086,7 @@ template <class OBJ> void GList<OBJ>::setCount(int NewCount) {
      GError(SLISTCOUNT_ERR, NewCount);
   if (NewCount > fCapacity) setCapacity(NewCount);
   if (NewCount > fCount)
-    memset(fList[fCount], 0, (NewCount - fCount) * sizeof(OBJ*));
+    memset(&fList[fCount], 0, (NewCount - fCount) * sizeof(OBJ*));
   fCount = NewCount;
 }
 
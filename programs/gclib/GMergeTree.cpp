@@ -0,0 +1,59 @@
+#include "GMergeTree.h"
+#include <sys/resource.h>
+
+//files kept open apart from the merged ones (std streams, output etc.)
+#define GMT_RESERVED_FILES 32
+
+GMergeTree::GMergeTree(int numsrc, GMergeCompareProc* cmp, void* data) {
+ k=numsrc;
+ cmpProc=cmp;
+ cmpData=data;
+ GCALLOC(tree, (k+1)*sizeof(int));
+ GCALLOC(done, (k+1)*sizeof(bool));
+}
+
+GMergeTree::~GMergeTree() {
+ GFREE(tree);
+ GFREE(done);
+}
+
+void GMergeTree::init() {
+ if (k==0) return;
+ //the leaves are nodes k..2k-1 (source s is leaf k+s), node n has the
+ //children 2n and 2n+1; the winners are propagated bottom-up
+ int* win;
+ GMALLOC(win, 2*k*sizeof(int));
+ for (int s=0;s<k;s++) win[k+s]=s;
+ for (int n=k-1;n>=1;n--) {
+   int s1=win[2*n];
+   int s2=win[2*n+1];
+   if (before(s2, s1)) { win[n]=s2; tree[n]=s1; }
+                  else { win[n]=s1; tree[n]=s2; }
+   }
+ tree[0]=(k>1) ? win[1] : 0;
+ GFREE(win);
+}
+
+void GMergeTree::replay(bool srcdone) {
+ int s=tree[0];
+ if (srcdone) done[s]=true;
+ //only the path from the winner's leaf up to the root can change
+ for (int n=(k+s)>>1;n>0;n>>=1) {
+   if (before(tree[n], s)) {
+     int t=tree[n];
+     tree[n]=s;
+     s=t;
+     }
+   }
+ tree[0]=s;
+}
+
+bool GReserveFiles(int numfiles) {
+ struct rlimit rl;
+ if (getrlimit(RLIMIT_NOFILE, &rl)!=0) return false;
+ rlim_t needed=numfiles+GMT_RESERVED_FILES;
+ if (rl.rlim_cur==RLIM_INFINITY || rl.rlim_cur>=needed) return true;
+ if (rl.rlim_max!=RLIM_INFINITY && rl.rlim_max<needed) return false;
+ rl.rlim_cur=needed;
+ return (setrlimit(RLIMIT_NOFILE, &rl)==0);
+}
@@ -0,0 +1,51 @@
+#ifndef GMERGETREE_H
+#define GMERGETREE_H
+#include "GBase.h"
+
+/* Tournament (loser) tree for k-way merging of sorted sources 0..k-1.
+   The tree only holds source indices: the caller keeps the current record
+   (and its pre-extracted sort keys) of each source and provides a compare
+   function for two sources. After the winner's record is consumed and
+   replaced by the next one from the same source (or the source ends),
+   replay() restores the order with log2(k) comparisons, so no records are
+   ever moved or allocated by the merge itself.
+   Records comparing equal come out in source order (lower index first).
+*/
+
+//returns <0 if the current record of source s1 goes before
+//the current record of source s2, >0 if after, 0 if equal
+typedef int GMergeCompareProc(int s1, int s2, void* data);
+
+class GMergeTree {
+ protected:
+  int k; //number of sources
+  int* tree; //tree[0]=winner, tree[1..k-1]=losers at internal nodes
+  bool* done; //sources with no more records
+  GMergeCompareProc* cmpProc;
+  void* cmpData;
+  bool before(int s1, int s2) { //s1 wins over s2
+     if (done[s1]) return false;
+     if (done[s2]) return true;
+     int c=cmpProc(s1, s2, cmpData);
+     return (c<0 || (c==0 && s1<s2));
+     }
+ public:
+  GMergeTree(int numsrc, GMergeCompareProc* cmp, void* data=NULL);
+  ~GMergeTree();
+  //marks a source as exhausted (before init(), for empty sources)
+  void setDone(int src) { done[src]=true; }
+  //builds the tree once every source has its first record loaded
+  void init();
+  //source holding the next record to output, or -1 when all are done
+  int top() { return (k==0 || done[tree[0]]) ? -1 : tree[0]; }
+  //to be called after the record of top() was replaced by the next
+  //record of that source; srcdone=true if that source has ended instead
+  void replay(bool srcdone=false);
+  int Count() { return k; }
+};
+
+//raises the soft limit of open files (up to the hard limit) so that
+//numfiles more files can be opened; returns false if that is not possible
+bool GReserveFiles(int numfiles);
+
+#endif
@@ -0,0 +1,69 @@
+#include "GUnionFind.h"
+
+#define UF_INIT_CAPACITY 1024
+
+GUnionFind::GUnionFind(int init_capacity) {
+ fParent=NULL;
+ fRank=NULL;
+ fCount=0;
+ fCapacity=0;
+ fSets=0;
+ if (init_capacity>0) Grow(init_capacity);
+}
+
+GUnionFind::~GUnionFind() {
+ GFREE(fParent);
+ GFREE(fRank);
+}
+
+void GUnionFind::Grow(int newcap) {
+ if (newcap<=fCapacity) return;
+ GREALLOC(fParent, newcap*sizeof(int));
+ GREALLOC(fRank, newcap*sizeof(unsigned char));
+ fCapacity=newcap;
+}
+
+void GUnionFind::Clear() {
+ GFREE(fParent);
+ GFREE(fRank);
+ fCount=0;
+ fCapacity=0;
+ fSets=0;
+}
+
+int GUnionFind::addItem() {
+ if (fCount==fCapacity) {
+   if (fCount>=INT_MAX/2)
+     GError("GUnionFind error: too many items (%d)\n", fCount);
+   Grow((fCapacity<UF_INIT_CAPACITY) ? UF_INIT_CAPACITY : fCapacity*2);
+   }
+ fParent[fCount]=fCount;
+ fRank[fCount]=0;
+ fSets++;
+ return fCount++;
+}
+
+int GUnionFind::Find(int i) {
+ //first pass: locate the root
+ int r=i;
+ while (fParent[r]!=r) r=fParent[r];
+ //second pass: compress the path, every visited item now points to r
+ while (fParent[i]!=r) {
+   int next=fParent[i];
+   fParent[i]=r;
+   i=next;
+   }
+ return r;
+}
+
+int GUnionFind::Union(int i1, int i2) {
+ int r1=Find(i1);
+ int r2=Find(i2);
+ if (r1==r2) return -1;
+ //attach the shallower tree under the deeper one
+ if (fRank[r1]<fRank[r2]) swap(r1,r2);
+ fParent[r2]=r1;
+ if (fRank[r1]==fRank[r2]) fRank[r1]++;
+ fSets--;
+ return r1;
+}
@@ -0,0 +1,36 @@
+#ifndef GUNIONFIND_H
+#define GUNIONFIND_H
+#include "GBase.h"
+
+/* Flat, index-based disjoint-set forest (union-find) over dense
+   integer item IDs 0..Count()-1, with path compression and union by rank.
+   Only the parent array and one rank byte are kept per item,
+   so no per-item or per-set objects are ever allocated.
+*/
+class GUnionFind {
+ protected:
+  int* fParent; //parent index for each item (roots point to themselves)
+  unsigned char* fRank; //upper bound of the tree height, valid for roots only
+  int fCount; //number of items
+  int fCapacity; //allocated size of fParent and fRank
+  int fSets; //current number of disjoint sets
+  void Grow(int newcap);
+ public:
+  GUnionFind(int init_capacity=0);
+  ~GUnionFind();
+  void setCapacity(int newcap) { if (newcap>fCapacity) Grow(newcap); }
+  //adds a new singleton set and returns the ID of its only item
+  int addItem();
+  //returns the root item ID of the set containing item i
+  int Find(int i);
+  //merges the sets containing items i1 and i2;
+  //returns the root of the merged set, or -1 if they were already together
+  int Union(int i1, int i2);
+  bool sameSet(int i1, int i2) { return Find(i1)==Find(i2); }
+  bool isRoot(int i) { return fParent[i]==i; }
+  int Count() { return fCount; }
+  int setCount() { return fSets; }
+  void Clear();
+};
+
+#endif
@@ -0,0 +1,284 @@
+#include "GZipWriter.h"
+#include <zlib.h>
+#include <bzlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+GZipWriter::GZipWriter(const char* fbasename, const char* ext, bool usebzip2,
+                       int threads, int64 maxpartsize, int zlevel, int bsize) {
+ bzip2=usebzip2;
+ level=zlevel;
+ if (level<0 || level>9) level=bzip2 ? 9 : Z_DEFAULT_COMPRESSION;
+ if (bzip2 && level==0) level=1;
+ fbase=Gstrdup(fbasename);
+ fext=Gstrdup(ext);
+ maxPartSize=maxpartsize;
+ numThreads=(threads<1) ? 1 : threads;
+ blockSize=bzip2 ? GZW_BZIP2_BLOCK : GZW_GZIP_BLOCK;
+ if (bsize>0) blockSize=bsize;
+ //enough blocks to keep all workers busy while the next one is filled
+ numBlocks=numThreads*2+1;
+ GCALLOC(blocks, numBlocks*sizeof(ZBlock));
+ curBlock=0;
+ nextCompress=0;
+ nextWrite=0;
+ closed=false;
+ stopping=false;
+ fout=NULL;
+ partNo=0;
+ partSize=0;
+ totalIn=0;
+ totalOut=0;
+ filterIn=NULL;
+ filterOut=NULL;
+ filterPid=0;
+ pthread_mutex_init(&lock, NULL);
+ pthread_cond_init(&cond, NULL);
+ GMALLOC(workers, numThreads*sizeof(pthread_t));
+ for (int i=0;i<numThreads;i++)
+   if (pthread_create(&workers[i], NULL, workerThread, this)!=0)
+     GError("GZipWriter error: cannot create worker thread %d!\n", i+1);
+}
+
+GZipWriter::~GZipWriter() {
+ close();
+ for (int i=0;i<numBlocks;i++) {
+   GFREE(blocks[i].buf);
+   GFREE(blocks[i].zbuf);
+   }
+ GFREE(blocks);
+ GFREE(workers);
+ GFREE(fbase);
+ GFREE(fext);
+ pthread_cond_destroy(&cond);
+ pthread_mutex_destroy(&lock);
+}
+
+void GZipWriter::compressBlock(ZBlock& b) {
+ if (bzip2) {
+   unsigned int zl=b.buflen+b.buflen/100+601;
+   if (b.zcap<(int)zl) {
+     b.zcap=zl;
+     GREALLOC(b.zbuf, b.zcap);
+     }
+   int r=BZ2_bzBuffToBuffCompress(b.zbuf, &zl, b.buf, b.buflen, level, 0, 0);
+   if (r!=BZ_OK) GError("GZipWriter error: bzip2 compression failed (%d)!\n", r);
+   b.zlen=zl;
+   return;
+   }
+ z_stream zs;
+ memset(&zs, 0, sizeof(zs));
+ //windowBits 15+16 for a gzip header and trailer
+ if (deflateInit2(&zs, level, Z_DEFLATED, 31, 8, Z_DEFAULT_STRATEGY)!=Z_OK)
+   GError("GZipWriter error: deflateInit2() failed!\n");
+ int zl=(int)deflateBound(&zs, b.buflen);
+ if (b.zcap<zl) {
+   b.zcap=zl;
+   GREALLOC(b.zbuf, b.zcap);
+   }
+ zs.next_in=(Bytef*)b.buf;
+ zs.avail_in=b.buflen;
+ zs.next_out=(Bytef*)b.zbuf;
+ zs.avail_out=b.zcap;
+ if (deflate(&zs, Z_FINISH)!=Z_STREAM_END)
+   GError("GZipWriter error: gzip compression failed!\n");
+ b.zlen=zs.total_out;
+ deflateEnd(&zs);
+}
+
+void* GZipWriter::workerThread(void* p) {
+ GZipWriter* zw=(GZipWriter*)p;
+ while (true) {
+   pthread_mutex_lock(&zw->lock);
+   while (!zw->stopping && zw->nextCompress>=zw->curBlock)
+     pthread_cond_wait(&zw->cond, &zw->lock);
+   if (zw->nextCompress>=zw->curBlock) { //stopping, nothing left to do
+     pthread_mutex_unlock(&zw->lock);
+     break;
+     }
+   ZBlock& b=zw->blocks[zw->nextCompress % zw->numBlocks];
+   b.state=zbCompressing;
+   zw->nextCompress++;
+   pthread_mutex_unlock(&zw->lock);
+   zw->compressBlock(b);
+   pthread_mutex_lock(&zw->lock);
+   b.state=zbDone;
+   pthread_cond_broadcast(&zw->cond);
+   pthread_mutex_unlock(&zw->lock);
+   }
+ return NULL;
+}
+
+//writes a compressed block, starting a new part if needed
+void GZipWriter::writeBlock(ZBlock& b) {
+ if (fout!=NULL && maxPartSize>0 && partSize>0 && partSize+b.zlen>maxPartSize) {
+   if (fclose(fout)!=0)
+     GError("GZipWriter error: failed closing part %d!\n", partNo);
+   fout=NULL;
+   }
+ if (fout==NULL) {
+   partNo++;
+   char* fname;
+   GMALLOC(fname, strlen(fbase)+strlen(fext)+16);
+   sprintf(fname, "%s_%03d%s", fbase, partNo, fext);
+   if ((fout=fopen(fname, "wb"))==NULL)
+     GError("GZipWriter error: cannot create file '%s'!\n", fname);
+   GFREE(fname);
+   partSize=0;
+   }
+ if ((int)fwrite(b.zbuf, 1, b.zlen, fout)!=b.zlen)
+   GError("GZipWriter error: failed writing part %d!\n", partNo);
+ partSize+=b.zlen;
+ totalOut+=b.zlen;
+}
+
+//writes the compressed blocks in order, up to (not including) block #upto;
+//if wait is false it stops at the first block that is not ready yet
+void GZipWriter::writeBlocks(long upto, bool wait) {
+ while (nextWrite<upto) {
+   ZBlock& b=blocks[nextWrite % numBlocks];
+   pthread_mutex_lock(&lock);
+   if (!wait && b.state!=zbDone) {
+     pthread_mutex_unlock(&lock);
+     break;
+     }
+   while (b.state!=zbDone) pthread_cond_wait(&cond, &lock);
+   pthread_mutex_unlock(&lock);
+   writeBlock(b);
+   b.buflen=0;
+   pthread_mutex_lock(&lock);
+   b.state=zbFree;
+   pthread_mutex_unlock(&lock);
+   nextWrite++;
+   }
+}
+
+void GZipWriter::endBlock() {
+ ZBlock& b=blocks[curBlock % numBlocks];
+ //an empty block is only sealed for an empty output (a valid empty part)
+ if (b.buflen==0 && !(closed && curBlock==0)) return;
+ pthread_mutex_lock(&lock);
+ b.state=zbFilled;
+ curBlock++;
+ pthread_cond_broadcast(&cond);
+ pthread_mutex_unlock(&lock);
+ writeBlocks(curBlock, false);
+ //the slot of the next block must be written out before reuse
+ writeBlocks(curBlock-numBlocks+1, true);
+}
+
+void GZipWriter::append(const char* data, int len) {
+ ZBlock& b=blocks[curBlock % numBlocks];
+ if (b.buflen+len>b.bufcap) {
+   b.bufcap=GMAX(blockSize, b.buflen+len);
+   GREALLOC(b.buf, b.bufcap);
+   }
+ memcpy(b.buf+b.buflen, data, len);
+ b.buflen+=len;
+ totalIn+=len;
+}
+
+void GZipWriter::write(const char* data, int len) {
+ if (closed) GError("GZipWriter error: write after close!\n");
+ if (!fits(len)) endBlock();
+ append(data, len);
+}
+
+void GZipWriter::writeLine(const char* line) {
+ int len=strlen(line);
+ if (closed) GError("GZipWriter error: write after close!\n");
+ if (!fits(len+1)) endBlock();
+ append(line, len);
+ append("\n", 1);
+}
+
+FILE* GZipWriter::openFilter(const char* cmd) {
+ if (filterIn!=NULL) GError("GZipWriter error: filter already started!\n");
+ int fin[2], fout[2];
+ if (pipe(fin)!=0 || pipe(fout)!=0)
+   GError("GZipWriter error: cannot create pipes for filter '%s'!\n", cmd);
+ fflush(NULL);
+ pid_t pid=fork();
+ if (pid<0) GError("GZipWriter error: cannot fork for filter '%s'!\n", cmd);
+ if (pid==0) {
+   dup2(fin[0], 0);
+   dup2(fout[1], 1);
+   ::close(fin[0]);
+   ::close(fin[1]);
+   ::close(fout[0]);
+   ::close(fout[1]);
+   execl("/bin/sh", "sh", "-c", cmd, (char*)NULL);
+   _exit(127);
+   }
+ ::close(fin[0]);
+ ::close(fout[1]);
+ filterPid=pid;
+ filterIn=fdopen(fin[1], "w");
+ filterOut=fdopen(fout[0], "r");
+ if (filterIn==NULL || filterOut==NULL)
+   GError("GZipWriter error: fdopen() failed for filter '%s'!\n", cmd);
+ if (pthread_create(&filterReader, NULL, filterThread, this)!=0)
+   GError("GZipWriter error: cannot create the filter reader thread!\n");
+ return filterIn;
+}
+
+//reads the filter's output and passes it on in line-aligned chunks
+void* GZipWriter::filterThread(void* p) {
+ GZipWriter* zw=(GZipWriter*)p;
+ int bufcap=65536;
+ int len=0;
+ char* buf;
+ GMALLOC(buf, bufcap);
+ int r;
+ while ((r=(int)fread(buf+len, 1, bufcap-len, zw->filterOut))>0) {
+   len+=r;
+   int k=len-1;
+   while (k>=0 && buf[k]!='\n') k--;
+   if (k<0) { //very long line
+     if (len==bufcap) {
+       bufcap*=2;
+       GREALLOC(buf, bufcap);
+       }
+     continue;
+     }
+   zw->write(buf, k+1);
+   len-=k+1;
+   memmove(buf, buf+k+1, len);
+   }
+ if (len>0) { //last line with no newline
+   if (len==bufcap) GREALLOC(buf, bufcap+1);
+   buf[len++]='\n';
+   zw->write(buf, len);
+   }
+ GFREE(buf);
+ fclose(zw->filterOut);
+ zw->filterOut=NULL;
+ return NULL;
+}
+
+void GZipWriter::close() {
+ if (closed) return;
+ if (filterIn!=NULL) {
+   //the filter gets EOF, then its remaining output is compressed
+   if (fclose(filterIn)!=0)
+     GError("GZipWriter error: failed writing to the filter command!\n");
+   filterIn=NULL;
+   pthread_join(filterReader, NULL);
+   int status=0;
+   if (waitpid(filterPid, &status, 0)<0 || !WIFEXITED(status) ||
+        WEXITSTATUS(status)!=0)
+     GError("GZipWriter error: the filter command failed!\n");
+   }
+ closed=true;
+ endBlock();
+ writeBlocks(curBlock, true);
+ pthread_mutex_lock(&lock);
+ stopping=true;
+ pthread_cond_broadcast(&cond);
+ pthread_mutex_unlock(&lock);
+ for (int i=0;i<numThreads;i++)
+   pthread_join(workers[i], NULL);
+ if (fout!=NULL && fclose(fout)!=0)
+   GError("GZipWriter error: failed closing part %d!\n", partNo);
+ fout=NULL;
+}
@@ -0,0 +1,97 @@
+#ifndef GZIPWRITER_H
+#define GZIPWRITER_H
+#include "GBase.h"
+#include <pthread.h>
+#include <sys/types.h>
+
+/* Block-parallel gzip/bzip2 compressor writing a series of output parts
+ named <fbase>_NNN<ext> (001, 002, ...).
+ The data is cut into blocks at record boundaries (a record is never split
+ across blocks) and each block is compressed independently by the worker
+ threads, as a complete gzip member or bzip2 stream; the concatenation of
+ such members is still a standard .gz/.bz2 file. The compressed blocks are
+ written in order, and since their sizes are known before writing, a new
+ part is started exactly when the next block would push the current part
+ over the size limit (a part can only be larger than the limit if it holds
+ a single block that is larger).
+ The data can also be passed through an external filter command first
+ (openFilter()); the filter's output is then read back by a separate
+ thread and compressed the same way.
+*/
+
+#define GZW_GZIP_BLOCK 1048576
+#define GZW_BZIP2_BLOCK 880000 //fits in one bzip2 -9 block
+
+class GZipWriter {
+ protected:
+  enum { zbFree=0, zbFilled, zbCompressing, zbDone };
+  struct ZBlock {
+    char* buf; //uncompressed data
+    int buflen;
+    int bufcap;
+    char* zbuf; //compressed data
+    int zlen;
+    int zcap;
+    int state;
+    };
+  bool bzip2;
+  int level;
+  char* fbase;
+  char* fext;
+  int64 maxPartSize; //0 = no limit
+  int numThreads;
+  int blockSize;
+  ZBlock* blocks; //ring of blocks, block #s is blocks[s % numBlocks]
+  int numBlocks;
+  long curBlock; //block # being filled
+  long nextCompress; //next block # to be taken by a worker
+  long nextWrite; //next block # to be written
+  bool closed;
+  bool stopping; //tells the workers to exit
+  FILE* fout;
+  int partNo;
+  int64 partSize;
+  double totalIn;
+  double totalOut;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  pthread_t* workers;
+  FILE* filterIn; //write end of the filter command's input
+  FILE* filterOut; //read end of the filter command's output
+  pid_t filterPid;
+  pthread_t filterReader;
+  void compressBlock(ZBlock& b);
+  void writeBlock(ZBlock& b);
+  void writeBlocks(long upto, bool wait);
+  void append(const char* data, int len);
+  static void* workerThread(void* p);
+  static void* filterThread(void* p);
+ public:
+  //maxpartsize is in bytes; level is the gzip/bzip2 compression level;
+  //bsize is the uncompressed block size (0 for the default)
+  GZipWriter(const char* fbasename, const char* ext, bool usebzip2,
+             int threads=1, int64 maxpartsize=0, int zlevel=-1, int bsize=0);
+  ~GZipWriter();
+  //true if a record of len bytes can be added to the current block
+  bool fits(int len) {
+     ZBlock& b=blocks[curBlock % numBlocks];
+     return (b.buflen==0 || b.buflen+len<=blockSize);
+     }
+  bool atBlockStart() { return blocks[curBlock % numBlocks].buflen==0; }
+  //seals the current block and hands it over to the workers
+  void endBlock();
+  //adds a record, starting a new block first if it does not fit
+  void write(const char* data, int len);
+  //adds a text line (a newline is appended)
+  void writeLine(const char* line);
+  //starts the filter command cmd (through /bin/sh) and returns the stream
+  //to write the data into; its output lines are compressed instead
+  FILE* openFilter(const char* cmd);
+  //flushes all the data and closes the last part (and the filter, if any)
+  void close();
+  int parts() { return partNo; }
+  double bytesIn() { return totalIn; }
+  double bytesOut() { return totalOut; }
+};
+
+#endif
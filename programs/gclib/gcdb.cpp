@@ -468,7 +468,6 @@ GCdbWrite::GCdbWrite(int afd) {
   cdbuf=new GCDBuffer((opfunc)&write,(int) afd,(char*)bspace,sizeof bspace);
   head = NULL;
   split = 0;
-  hash = 0;
   numentries = 0;
   fd = afd;
   pos = sizeof final;
@@ -494,7 +493,6 @@ GCdbWrite::GCdbWrite(char* afname) {
   cdbuf=new GCDBuffer((opfunc)&write,(int) fd,(char*)bspace,sizeof bspace);
   head = NULL;
   split = 0;
-  hash = 0;
   numentries = 0;
   pos = sizeof final;
   gcdb_seek_set(fd, pos);
@@ -595,16 +593,23 @@ int GCdbWrite::addrec(const char *key,unsigned int keylen,char *data,unsigned in
 }
 
 
-int GCdbWrite::finish() {
-  char buf[8];
+int GCdbWrite::addrecs(const char* recs, uint32 len, const uint32* hashes, int n) {
+  if (cdbuf->putalign((char*)recs,len) == -1) return -1;
+  const char* p=recs;
+  for (int i=0;i<n;i++) {
+    uint32 keylen, datalen;
+    uint32_unpack((char*)p,&keylen);
+    uint32_unpack((char*)p+4,&datalen);
+    if (GCdbWrite::addend(keylen,datalen,hashes[i]) == -1) return -1;
+    p+=8+keylen+datalen;
+    }
+  return 0;
+}
+
+int GCdbWrite::beginTables() {
   int i;
-  uint32 len;
   uint32 u;
-  uint32 memsize;
-  uint32 icount;
-  uint32 where;
   struct cdb_hplist *x;
-  struct cdb_hp *hp;
 
   for (i = 0;i < 256;++i)
     count[i] = 0;
@@ -615,67 +620,87 @@ int GCdbWrite::finish() {
       ++count[255 & x->hp[i].h];
   }
 
-  memsize = 1;
-  for (i = 0;i < 256;++i) {
-    u = count[i] * 2;
-    if (u > memsize)
-      memsize = u;
-  }
-
-  memsize += numentries; /* no overflow possible up to now */
   u = (uint32) 0 - (uint32) 1;
   u /= sizeof(struct cdb_hp);
-  if (memsize > u) { /* errno = error_nomem;*/ return -1; }
+  if (numentries > u) { /* errno = error_nomem;*/ return -1; }
 
-  split = (struct cdb_hp *) gcdb_alloc(memsize * sizeof(struct cdb_hp));
+  split = (struct cdb_hp *) gcdb_alloc((numentries+1) * sizeof(struct cdb_hp));
   if (!split) return -1;
 
-  hash = split + numentries;
-
   u = 0;
   for (i = 0;i < 256;++i) {
     u += count[i]; /* bounded by numentries, so no overflow */
     start[i] = u;
   }
 
+  //entries of each table end up in the order they were added
   for (x = head;x;x = x->next) {
     i = x->num;
     while (i--)
       split[--start[255 & x->hp[i].h]] = x->hp[i];
   }
+  return 0;
+}
 
-  for (i = 0;i < 256;++i) {
-    icount = count[i];
-
-    len = icount + icount; /* no overflow possible */
-    uint32_pack(final + 8 * i,pos);
-    uint32_pack(final + 8 * i + 4,len);
-
-    for (u = 0;u < len;++u)
-      hash[u].h = hash[u].p = 0;
-
-    hp = split + start[i];
-    for (u = 0;u < icount;++u) {
-      where = (hp->h >> 8) % len;
-      while (hash[where].p)
-	if (++where == len)
-	  where = 0;
-      hash[where] = *hp++;
-    }
+void GCdbWrite::buildTable(int i, char* tbl) {
+  uint32 u;
+  uint32 where;
+  uint32 icount = count[i];
+  uint32 len = icount + icount; /* no overflow possible */
+  if (len==0) return;
+  struct cdb_hp *thash;
+  GMALLOC(thash, len * sizeof(struct cdb_hp));
+  for (u = 0;u < len;++u)
+    thash[u].h = thash[u].p = 0;
+
+  struct cdb_hp *hp = split + start[i];
+  for (u = 0;u < icount;++u) {
+    where = (hp->h >> 8) % len;
+    while (thash[where].p)
+      if (++where == len)
+        where = 0;
+    thash[where] = *hp++;
+  }
 
-    for (u = 0;u < len;++u) {
-      uint32_pack(buf,hash[u].h);
-      uint32_pack(buf + 4,hash[u].p);
-      if (cdbuf->putalign(buf,8) == -1) return -1;
-      if (posplus(8) == -1) return -1;
-    }
+  for (u = 0;u < len;++u) {
+    uint32_pack(tbl + (u<<3),thash[u].h);
+    uint32_pack(tbl + (u<<3) + 4,thash[u].p);
   }
+  GFREE(thash);
+}
+
+int GCdbWrite::writeTable(int i, char* tbl) {
+  uint32 len = count[i] + count[i];
+  uint32_pack(final + 8 * i,pos);
+  uint32_pack(final + 8 * i + 4,len);
+  if (len==0) return 0;
+  if (cdbuf->putalign(tbl,len<<3) == -1) return -1;
+  if (posplus(len<<3) == -1) return -1;
+  return 0;
+}
 
+int GCdbWrite::endTables() {
   if (cdbuf->flush() == -1) return -1;
   if (gcdb_seek_begin(fd) == -1) return -1;
   return cdbuf->putflush(final,sizeof final);
 }
 
+int GCdbWrite::finish() {
+  if (beginTables() == -1) return -1;
+  char* tbl=NULL;
+  uint32 tblcap=0;
+  for (int i = 0;i < 256;++i) {
+    if (tableSize(i)>tblcap) {
+      tblcap=tableSize(i);
+      GREALLOC(tbl, tblcap);
+      }
+    buildTable(i, tbl);
+    if (writeTable(i, tbl) == -1) { GFREE(tbl); return -1; }
+  }
+  GFREE(tbl);
+  return endTables();
+}
+
 //=====================================================
 //-------------        cdb          -------------------
 //=====================================================
@@ -820,6 +845,9 @@ int GCdbRead::findnext(const char *key,unsigned int len) {
   char buf[8];
   uint32 pos;
   uint32 u;
+  #ifndef NO_MMAP
+  if (map) return mapfindnext(key,len);
+  #endif
   if (!loop) {
     u = cdb_hash(key,len);
     if (GCdbRead::read(buf,8,(u << 3) & 2047) == -1) return -1;
@@ -857,11 +885,460 @@ int GCdbRead::findnext(const char *key,unsigned int len) {
   return 0;
 }
 
+//same as findnext() but probing the mapped hash tables in place
+int GCdbRead::mapfindnext(const char *key,unsigned int len) {
+  const char* p;
+  uint32 pos;
+  uint32 u;
+  if (!loop) {
+    u = cdb_hash(key,len);
+    if ((p=mapped((u << 3) & 2047, 8)) == NULL) return -1;
+    uint32_unpack((char*)p + 4,&hslots);
+    if (!hslots) return 0;
+    uint32_unpack((char*)p,&hpos);
+    khash = u;
+    u >>= 8;
+    u %= hslots;
+    u <<= 3;
+    kpos = hpos + u;
+    }
+  while (loop < hslots) {
+    if ((p=mapped(kpos,8)) == NULL) return -1;
+    uint32_unpack((char*)p + 4, &pos);
+    if (!pos) return 0;
+    loop += 1;
+    kpos += 8;
+    if (kpos == hpos + (hslots << 3)) kpos = hpos;
+    uint32_unpack((char*)p,&u);
+    if (u == khash) {
+      if ((p=mapped(pos,8)) == NULL) return -1;
+      uint32_unpack((char*)p,&u);
+      if (u == len) {
+        if (mapped(pos + 8,len) == NULL) return -1;
+        if (memcmp(p + 8,key,len) == 0) {
+          uint32_unpack((char*)p + 4,&dlen);
+          dpos = pos + 8 + len;
+          return 1;
+          }
+        }
+    }
+  }
+  return 0;
+}
+
 int GCdbRead::find(const char *key) {
   GCdbRead::findstart();
   return GCdbRead::findnext(key,gcdb_strlen(key));
 }
 
+//----- GMappedFile
+
+GMappedFile::GMappedFile(int fd) {
+  struct stat st;
+  map=NULL;
+  size=0;
+  if (fstat(fd,&st) != 0) return;
+  size=st.st_size;
+  #ifndef NO_MMAP
+  //an empty or unmappable file is simply left to be read the usual way
+  if (size>0 && (off_t)(size_t)size==size) {
+    char* x = (char *) mmap(0,(size_t)size,PROT_READ,MAP_SHARED,fd,0);
+    if (x != (char*)MAP_FAILED) map=x;
+    }
+  #endif
+}
+
+GMappedFile::~GMappedFile() {
+  if (map!=NULL) {
+    munmap(map,(size_t)size);
+    map=NULL;
+    }
+}
+
+//----- GCdbBatchReader
+
+//records closer than this are fetched by the same read
+#define GCDB_BATCH_MAXGAP 65536
+
+static int cmpRecLocPos(const void* p1, const void* p2) {
+  const GCdbRecLoc* a=(const GCdbRecLoc*)p1;
+  const GCdbRecLoc* b=(const GCdbRecLoc*)p2;
+  if (a->fpos!=b->fpos) return (a->fpos<b->fpos) ? -1 : 1;
+  return a->seq-b->seq;
+}
+
+static int cmpRecLocSeq(const void* p1, const void* p2) {
+  return ((const GCdbRecLoc*)p1)->seq-((const GCdbRecLoc*)p2)->seq;
+}
+
+GCdbBatchReader::GCdbBatchReader(int afd, GMappedFile* amap) {
+  fd=afd;
+  fmap=(amap!=NULL && amap->mapped()) ? amap : NULL;
+  zreader=NULL;
+  buf=NULL;
+  bufcap=0;
+  #ifdef POSIX_FADV_SEQUENTIAL
+  if (fmap==NULL) posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  #endif
+}
+
+GCdbBatchReader::GCdbBatchReader(GCdbBlockZReader* azreader) {
+  fd=-1;
+  fmap=NULL;
+  zreader=azreader;
+  buf=NULL;
+  bufcap=0;
+}
+
+GCdbBatchReader::~GCdbBatchReader() {
+  GFREE(buf);
+}
+
+void GCdbBatchReader::sortBySeq(GCdbRecLoc* locs, int count) {
+  qsort(locs, count, sizeof(GCdbRecLoc), cmpRecLocSeq);
+}
+
+//reads len bytes from offset pos, returns the number of bytes read
+size_t GCdbBatchReader::readRun(off_t pos, char* dest, size_t len) {
+  #ifdef ENABLE_COMPRESSION
+  if (zreader!=NULL) return zreader->read(pos, dest, len);
+  #endif
+  size_t got=0;
+  if (gcdb_seek_set(fd, pos)==-1) return 0;
+  while (got<len) {
+    int r;
+    do {
+      r=::read(fd, dest+got, len-got);
+      } while ((r == -1) && (errno == error_intr));
+    if (r<=0) break;
+    got+=r;
+    }
+  return got;
+}
+
+//extends the run of nearby records starting at locs[i]; returns the index
+//past its last record and sets rend to the end of the run. The gaps bridged
+//are taken from gapleft, so the runs of a batch never span more gap bytes
+//than the records themselves hold
+static int recRun(GCdbRecLoc* locs, int count, int i, off_t& rend, off_t& gapleft) {
+  rend=locs[i].fpos+locs[i].reclen;
+  int j=i+1;
+  while (j<count) {
+    off_t gap=locs[j].fpos-rend;
+    if (gap>GCDB_BATCH_MAXGAP) break;
+    if (gap>0) {
+      if (gap>gapleft) break;
+      gapleft-=gap;
+      }
+    off_t e=locs[j].fpos+locs[j].reclen;
+    if (e>rend) rend=e;
+    j++;
+    }
+  return j;
+}
+
+void GCdbBatchReader::load(GCdbRecLoc* locs, int count) {
+  if (count<=0) return;
+  qsort(locs, count, sizeof(GCdbRecLoc), cmpRecLocPos);
+  //group the records in runs of nearby records, [rstart..rend) in file
+  off_t gapbudget=0;
+  int i;
+  for (i=0;i<count;i++) gapbudget+=locs[i].reclen;
+  off_t gapleft;
+  off_t rend;
+  size_t bufpos=0;
+  if (fmap==NULL) { //make room for all the runs first
+    size_t total=0;
+    gapleft=gapbudget;
+    for (i=0;i<count;) {
+      int j=recRun(locs, count, i, rend, gapleft);
+      total+=rend-locs[i].fpos;
+      i=j;
+      }
+    if (total>bufcap) {
+      GFREE(buf);
+      GMALLOC(buf, total);
+      bufcap=total;
+      }
+    }
+  gapleft=gapbudget;
+  i=0;
+  while (i<count) {
+    off_t rstart=locs[i].fpos;
+    int j=recRun(locs, count, i, rend, gapleft);
+    if (fmap!=NULL) {
+      const char* p=fmap->view(rstart, rend-rstart);
+      #ifdef MADV_WILLNEED
+      if (p!=NULL) { //start reading the run ahead of use
+        long pgsize=sysconf(_SC_PAGESIZE);
+        const char* pg=p-((size_t)p % pgsize);
+        madvise((void*)pg, (p-pg)+(rend-rstart), MADV_WILLNEED);
+        }
+      #endif
+      for (int k=i;k<j;k++)
+        locs[k].data=fmap->view(locs[k].fpos, locs[k].reclen);
+      }
+    else {
+      //read the whole run at once, gaps included
+      size_t runlen=rend-rstart;
+      size_t got=readRun(rstart, buf+bufpos, runlen);
+      for (int k=i;k<j;k++) {
+        size_t ofs=locs[k].fpos-rstart;
+        locs[k].data=(ofs+locs[k].reclen<=got) ? buf+bufpos+ofs : NULL;
+        }
+      bufpos+=runlen;
+      }
+    i=j;
+    }
+}
+
+#ifdef ENABLE_COMPRESSION
+//----- GCdbBlockZWriter
+
+GCdbBlockZWriter::GCdbBlockZWriter(FILE* af, uint32 blocksize) {
+  gcvt_uint=(endian_test())? &uint32_sun : &uint32_x86;
+  gcvt_offt=(endian_test())? &offt_sun : &offt_x86;
+  zf=af;
+  bsize=blocksize;
+  GMALLOC(ubuf, bsize);
+  ulen=0;
+  zcap=compressBound(bsize);
+  GMALLOC(zbuf, zcap);
+  upos=0;
+  boffs=NULL;
+  numblocks=0;
+  bcap=0;
+  uint32 v=gcvt_uint(&bsize);
+  if (fwrite(GCDBZ_BLOCK_TAG, 1, 4, zf)<4 || fwrite(&v, 1, 4, zf)<4)
+    GError("GCdbBlockZWriter: error writing the file header!\n");
+  zpos=8;
+}
+
+GCdbBlockZWriter::~GCdbBlockZWriter() {
+  GFREE(ubuf);
+  GFREE(zbuf);
+  GFREE(boffs);
+}
+
+void GCdbBlockZWriter::flushBlock() {
+  if (ulen==0) return;
+  uLongf zlen=zcap;
+  int err=compress2((Bytef*)zbuf, &zlen, (Bytef*)ubuf, ulen, Z_DEFAULT_COMPRESSION);
+  if (err!=Z_OK)
+    GError("GCdbBlockZWriter: compress2() failed! (err=%d)\n", err);
+  uint32 v=(uint32)zlen;
+  v=gcvt_uint(&v);
+  if (fwrite(&v, 1, 4, zf)<4 || fwrite(zbuf, 1, zlen, zf)<zlen)
+    GError("GCdbBlockZWriter: error writing compressed block!\n");
+  if (numblocks==bcap) {
+    bcap=(bcap==0) ? 1024 : bcap*2;
+    GREALLOC(boffs, bcap*sizeof(off_t));
+    }
+  boffs[numblocks++]=zpos;
+  zpos+=4+zlen;
+  upos+=ulen;
+  ulen=0;
+}
+
+void GCdbBlockZWriter::write(const char* data, uint32 len) {
+  while (len>0) {
+    if (ulen==bsize) flushBlock();
+    uint32 n=bsize-ulen;
+    if (n>len) n=len;
+    memcpy(ubuf+ulen, data, n);
+    ulen+=n;
+    data+=n;
+    len-=n;
+    }
+}
+
+void GCdbBlockZWriter::finish() {
+  flushBlock();
+  fflush(zf);
+}
+
+/* block index layout: the file offsets of all blocks and of the file end
+   (64 bit), followed by the uncompressed data size (64 bit), the number of
+   blocks, the block size and the "CDBB" tag
+*/
+int GCdbBlockZWriter::writeIndex(int fd) {
+  char bspace[GCDBUFFER_OUTSIZE];
+  GCDBuffer ibuf((opfunc)&::write, fd, bspace, sizeof bspace);
+  for (int i=0;i<=numblocks;i++) {
+    off_t v=(i<numblocks) ? boffs[i] : zpos;
+    v=gcvt_offt(&v);
+    if (ibuf.putalign((char*)&v, sizeof(off_t))==-1) return -1;
+    }
+  off_t v=gcvt_offt(&upos);
+  uint32 n=gcvt_uint(&numblocks);
+  uint32 b=gcvt_uint(&bsize);
+  if (ibuf.putalign((char*)&v, sizeof(off_t))==-1 ||
+      ibuf.putalign((char*)&n, 4)==-1 || ibuf.putalign((char*)&b, 4)==-1 ||
+      ibuf.putalign((char*)GCDBZ_BLOCK_TAG, 4)==-1) return -1;
+  return ibuf.flush();
+}
+
+//----- GCdbBlockZReader
+
+GCdbBlockZReader::GCdbBlockZReader(int afd, int cacheblocks) {
+  gcvt_uint=(endian_test())? &uint32_sun : &uint32_x86;
+  gcvt_offt=(endian_test())? &offt_sun : &offt_x86;
+  fd=afd;
+  bsize=0;
+  numblocks=0;
+  boffs=NULL;
+  usize=0;
+  cachesize=(cacheblocks<1) ? 1 : cacheblocks;
+  GMALLOC(cache, cachesize*sizeof(ZBlock));
+  for (int i=0;i<cachesize;i++) {
+    cache[i].block=-1;
+    cache[i].data=NULL;
+    cache[i].len=0;
+    cache[i].lastuse=0;
+    }
+  usecount=0;
+  zbuf=NULL;
+  zcap=0;
+  rbuf=NULL;
+  rcap=0;
+  char hdr[8];
+  if (::read(fd, hdr, 8)==8 && memcmp(hdr, GCDBZ_BLOCK_TAG, 4)==0)
+    bsize=gcvt_uint(hdr+4);
+}
+
+GCdbBlockZReader::~GCdbBlockZReader() {
+  for (int i=0;i<cachesize;i++) GFREE(cache[i].data);
+  GFREE(cache);
+  GFREE(boffs);
+  GFREE(zbuf);
+  GFREE(rbuf);
+}
+
+bool GCdbBlockZReader::readIndex(int idxfd, off_t endpos) {
+  char tail[20];
+  if (endpos<20 || lseek(idxfd, endpos-20, SEEK_SET)<0 ||
+       ::read(idxfd, tail, 20)!=20 || memcmp(tail+16, GCDBZ_BLOCK_TAG, 4)!=0)
+    return false;
+  usize=gcvt_offt(tail);
+  numblocks=gcvt_uint(tail+8);
+  if (gcvt_uint(tail+12)!=bsize) return false;
+  off_t ilen=(off_t)(numblocks+1)*sizeof(off_t);
+  if (endpos-20<ilen) return false;
+  GMALLOC(boffs, ilen);
+  if (lseek(idxfd, endpos-20-ilen, SEEK_SET)<0 || ::read(idxfd, boffs, ilen)!=ilen)
+    return false;
+  for (int i=0;i<=numblocks;i++) boffs[i]=gcvt_offt(&boffs[i]);
+  return true;
+}
+
+//returns the decompressed block b, from the cache if possible
+const char* GCdbBlockZReader::getBlock(int b, uint32& len) {
+  usecount++;
+  int lru=0;
+  for (int i=0;i<cachesize;i++) {
+    if (cache[i].block==b) {
+      cache[i].lastuse=usecount;
+      len=cache[i].len;
+      return cache[i].data;
+      }
+    if (cache[i].lastuse<cache[lru].lastuse) lru=i;
+    }
+  ZBlock& c=cache[lru];
+  c.block=-1;
+  uint32 zlen=(uint32)(boffs[b+1]-boffs[b]);
+  if (zlen>zcap) {
+    GREALLOC(zbuf, zlen);
+    zcap=zlen;
+    }
+  if (lseek(fd, boffs[b], SEEK_SET)<0) return NULL;
+  uint32 got=0;
+  while (got<zlen) {
+    int r=::read(fd, zbuf+got, zlen-got);
+    if (r<=0) return NULL;
+    got+=r;
+    }
+  if (c.data==NULL) GMALLOC(c.data, bsize);
+  uLongf ulen=bsize;
+  if (uncompress((Bytef*)c.data, &ulen, (Bytef*)zbuf+4, zlen-4)!=Z_OK)
+    return NULL;
+  c.block=b;
+  c.len=ulen;
+  c.lastuse=usecount;
+  len=c.len;
+  return c.data;
+}
+
+size_t GCdbBlockZReader::read(off_t pos, char* dest, size_t len) {
+  size_t got=0;
+  if (pos<0) return 0;
+  while (got<len && pos<usize) {
+    int b=(int)(pos/bsize);
+    uint32 ofs=(uint32)(pos%bsize);
+    uint32 blen=0;
+    const char* p=getBlock(b, blen);
+    if (p==NULL || ofs>=blen) break;
+    size_t n=blen-ofs;
+    if (n>len-got) n=len-got;
+    memcpy(dest+got, p+ofs, n);
+    got+=n;
+    pos+=n;
+    }
+  return got;
+}
+
+const char* GCdbBlockZReader::view(off_t pos, uint32 len) {
+  if (boffs==NULL || pos<0 || pos>usize || usize-pos<len) return NULL;
+  int b=(int)(pos/bsize);
+  uint32 ofs=(uint32)(pos%bsize);
+  if (ofs+len<=bsize) { //the whole record is in one block
+    uint32 blen=0;
+    const char* p=getBlock(b, blen);
+    if (p==NULL || ofs+len>blen) return NULL;
+    return p+ofs;
+    }
+  if (len>rcap) {
+    GREALLOC(rbuf, len);
+    rcap=len;
+    }
+  if (read(pos, rbuf, len)<len) return NULL;
+  return rbuf;
+}
+
+off_t GCdbBlockZReader::dump(FILE* fout) {
+  if (bsize==0) return -1;
+  off_t total=0;
+  char* ubuf=NULL;
+  GMALLOC(ubuf, bsize);
+  if (lseek(fd, 8, SEEK_SET)<0) total=-1;
+  while (total>=0) {
+    char hdr[4];
+    int r=::read(fd, hdr, 4);
+    if (r==0) break;
+    if (r!=4) { total=-1; break; }
+    uint32 zlen=gcvt_uint(hdr);
+    if (zlen>zcap) {
+      GREALLOC(zbuf, zlen);
+      zcap=zlen;
+      }
+    uint32 got=0;
+    while (got<zlen) {
+      r=::read(fd, zbuf+got, zlen-got);
+      if (r<=0) break;
+      got+=r;
+      }
+    uLongf ulen=bsize;
+    if (got<zlen || uncompress((Bytef*)ubuf, &ulen, (Bytef*)zbuf, zlen)!=Z_OK ||
+         fwrite(ubuf, 1, ulen, fout)<ulen) {
+      total=-1;
+      break;
+      }
+    total+=ulen;
+    }
+  GFREE(ubuf);
+  return total;
+}
+#endif
+
 //----- GReadBuf and GReadBufLine
 
 char* GReadBufLine::readline(int idx) {
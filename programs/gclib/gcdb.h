@@ -120,6 +120,9 @@ extern int error_proto;
 #define CDBMSK_OPT_C        0x00000002
 #define CDBMSK_OPT_CADD     0x00000004
 #define CDBMSK_OPT_COMPRESS 0x00000008
+//the compressed database is a block store (GCdbBlockZWriter), with
+//its block index written in the cdb file before the db name
+#define CDBMSK_OPT_BLOCKZ   0x00000010
 //creates a compressed version of the database
 //uses plenty of unions for ensuring compatibility with
 // the old 'CIDX' info structure
@@ -188,8 +191,7 @@ class GCdbWrite {
    uint32 count[256];
    uint32 start[256];
    struct cdb_hplist *head;
-   struct cdb_hp *split; /* includes space for hash */
-   struct cdb_hp *hash;
+   struct cdb_hp *split; //all entries, grouped by hash table
    uint32 numentries;
    uint32 pos; //file position
    int posplus(uint32 len);
@@ -203,8 +205,19 @@ class GCdbWrite {
    int addend(unsigned int keylen,unsigned int datalen,uint32 h);
    int addrec(const char *key,unsigned int keylen,char *data,unsigned int datalen);
    int add(const char *key, char *data, unsigned int datalen);
+   //appends n records already laid out as in the cdb file
+   //(keylen, datalen, key, data), with their precomputed key hashes
+   int addrecs(const char* recs, uint32 len, const uint32* hashes, int n);
    int getNumEntries() { return numentries; }
    int finish();
+   //finish() in steps, so the 256 hash tables can be built concurrently:
+   //beginTables(), then buildTable() for each table (thread safe), with
+   //each table written in order (0..255) by writeTable(), then endTables()
+   int beginTables();
+   uint32 tableSize(int i) { return count[i]<<4; } //bytes in table i
+   void buildTable(int i, char* tbl);
+   int writeTable(int i, char* tbl);
+   int endTables();
    int close();
    int getfd() { return fd; }
    char* getfile() { return fname; }
@@ -232,6 +245,7 @@ class GCdbRead {
   char fname[1024];
   char *map; // 0 if no map is available
   int fd;
+  int mapfindnext(const char *key,unsigned int len);
  public:
 //methods:
   GCdbRead(int fd); //was cdb_init
@@ -246,8 +260,148 @@ class GCdbRead {
   int datalen() { return dlen; }
   int getfd() { return fd; }
   char* getfile() { return fname; }
+  //zero-copy access to the mapped index: NULL if the index is not
+  //mapped or pos..pos+len-1 is out of range
+  const char* mapped(uint32 pos, unsigned int len) {
+    if (map==NULL || pos>size || size-pos<len) return NULL;
+    return map+pos;
+    }
+  //data of the last record found, NULL if the index is not mapped
+  const char* dataptr() { return mapped(dpos, dlen); }
+};
+
+// read-only mapping of a whole (data) file, e.g. the fasta file indexed
+// by cdbfasta, so records can be accessed in place without any copying
+class GMappedFile {
+  char* map; // NULL if the file could not be mapped (or NO_MMAP)
+  off_t size;
+ public:
+  GMappedFile(int fd);
+  ~GMappedFile();
+  bool mapped() { return map!=NULL; }
+  off_t getSize() { return size; }
+  //pointer to len bytes at file offset pos, NULL if not available
+  const char* view(off_t pos, off_t len) {
+    if (map==NULL || pos<0 || pos>size || size-pos<len) return NULL;
+    return map+pos;
+    }
 };
 
+// a record of the indexed (fasta) file, as located by a cdb lookup
+struct GCdbRecLoc {
+  off_t fpos; //file offset of the record
+  uint32 reclen; //record length
+  int seq; //order in which the record was requested
+  int key; //caller data (e.g. the index of the key that found it)
+  const char* data; //record text, set by GCdbBatchReader::load()
+};
+
+// fetches many records at once: the requested records are visited in file
+// order, with nearby records pulled in by a single large read (or by a
+// prefetch of the mapped pages), instead of seeking back and forth
+class GCdbBlockZReader;
+
+class GCdbBatchReader {
+  int fd;
+  GMappedFile* fmap; //if the file is mapped, records are not copied
+  GCdbBlockZReader* zreader; //block compressed database, if not NULL
+  char* buf; //holds the records read so far (unmapped file only)
+  size_t bufcap;
+  size_t readRun(off_t pos, char* dest, size_t len);
+ public:
+  GCdbBatchReader(int afd, GMappedFile* amap=NULL);
+  GCdbBatchReader(GCdbBlockZReader* azreader);
+  ~GCdbBatchReader();
+  //sorts locs by file offset and sets their data pointers, which stay
+  //valid until the next load(); data is NULL for records beyond the EOF.
+  //An unmapped file is read into a buffer of at most twice the total
+  //length of the records, gaps between them included
+  void load(GCdbRecLoc* locs, int count);
+  //restores the order in which the records were requested
+  static void sortBySeq(GCdbRecLoc* locs, int count);
+};
+
+#ifdef ENABLE_COMPRESSION
+#include <zlib.h>
+
+/* Block compressed database store (cdbfasta -z):
+ "CDBB" tag, uint32 block size, then the blocks, each written as
+ <uint32 compressed length><zlib stream>. Every block holds block size
+ bytes of the original data (except the last one), so records are
+ still addressed by their offset in the uncompressed data and may
+ span blocks. The block offsets are written separately, at the end of
+ the cdb index (writeIndex()), for random access.
+*/
+#define GCDBZ_BLOCK_TAG "CDBB"
+#define GCDBZ_BLOCK_SIZE 0x10000
+//decompressed blocks kept by GCdbBlockZReader
+#define GCDBZ_CACHE_BLOCKS 64
+
+class GCdbBlockZWriter {
+  FILE* zf;
+  uint32 bsize;
+  char* ubuf; //data of the current block
+  uint32 ulen;
+  char* zbuf; //the compressed block
+  uLong zcap;
+  off_t zpos; //compressed file position
+  off_t upos; //uncompressed data before the current block
+  off_t* boffs; //file offset of each block
+  int numblocks;
+  int bcap;
+  void flushBlock();
+ public:
+  GCdbBlockZWriter(FILE* af, uint32 blocksize=GCDBZ_BLOCK_SIZE);
+  ~GCdbBlockZWriter();
+  void write(const char* data, uint32 len);
+  void putChar(char c) {
+    if (ulen==bsize) flushBlock();
+    ubuf[ulen++]=c;
+    }
+  off_t getPos() { return upos+ulen; } //uncompressed data written so far
+  void finish(); //writes the last block
+  off_t getZSize() { return zpos; } //file size, after finish()
+  //appends the block index to an open cdb file
+  int writeIndex(int fd);
+};
+
+class GCdbBlockZReader {
+  struct ZBlock {
+    int block; //-1 if unused
+    char* data;
+    uint32 len;
+    unsigned long lastuse;
+    };
+  int fd;
+  uint32 bsize;
+  int numblocks;
+  off_t* boffs; //file offset of each block, plus the file end
+  off_t usize; //uncompressed data size
+  ZBlock* cache;
+  int cachesize;
+  unsigned long usecount;
+  char* zbuf;
+  uint32 zcap;
+  char* rbuf; //copy of the last record spanning blocks
+  uint32 rcap;
+  const char* getBlock(int b, uint32& len);
+ public:
+  //fd must be positioned at the start of the file
+  GCdbBlockZReader(int afd, int cacheblocks=GCDBZ_CACHE_BLOCKS);
+  ~GCdbBlockZReader();
+  bool valid() { return bsize>0; } //the file has the block store tag
+  //loads the block index from a cdb file, ending at file offset endpos
+  bool readIndex(int idxfd, off_t endpos);
+  //len bytes at offset pos in the uncompressed data; the pointer is valid
+  //until the next call, NULL if out of range or on a read error
+  const char* view(off_t pos, uint32 len);
+  //copies len bytes at offset pos in dest, returns the number copied
+  size_t read(off_t pos, char* dest, size_t len);
+  //decompresses the whole file to fout (no index needed)
+  off_t dump(FILE* fout);
+};
+#endif
+
 class GReadBuf {
  protected:
   FILE* f;